@@ -0,0 +1,101 @@
+// The oracle must agree with itself across its calls, and its top-k shares
+// must stay close to an exact enumeration of the scrambled zipfian.
+#include "ycsbgen.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace YCSBGen;
+
+static int failures = 0;
+
+static void Expect(bool ok, const std::string& what) {
+  if (!ok) {
+    std::cerr << what << std::endl;
+    failures++;
+  }
+}
+
+// The iterator, Probability and TopShare of a run generator describe the
+// same distribution over the inserted keys.
+static void CheckRunOracle(const char* dist, double insert_proportion) {
+  YCSBGeneratorOptions options;
+  options.record_count = 20000;
+  options.operation_count = 20000;
+  options.insert_proportion = insert_proportion;
+  options.read_proportion = 1 - insert_proportion;
+  options.request_distribution = dist;
+  YCSBRunGenerator gen(options, options.record_count);
+  std::string name = std::string(dist) + " insert " +
+                     std::to_string(insert_proportion) + ": ";
+
+  std::set<uint64_t> seen;
+  std::vector<double> prefix(1, 0);
+  for (auto it = gen.NewHotKeyIterator(); it.Valid(); it.Next()) {
+    Expect(it.index() < options.record_count, name + "uninserted key");
+    Expect(seen.insert(it.index()).second, name + "repeated key");
+    Expect(std::abs(it.probability() - gen.Probability(it.index())) <=
+               1e-12 * it.probability(),
+           name + "iterator and Probability disagree");
+    prefix.push_back(prefix.back() + it.probability());
+  }
+  Expect(std::abs(prefix.back() - 1) < 1e-6, name + "probabilities sum to " +
+                                                 std::to_string(prefix.back()));
+  for (uint64_t k : {1, 10, 100, 1000, 10000}) {
+    k = std::min<uint64_t>(k, prefix.size() - 1);
+    Expect(std::abs(gen.TopShare(k) - prefix[k]) < 1e-6,
+           name + "TopShare(" + std::to_string(k) + ") disagrees");
+  }
+}
+
+// Shares of the k hottest keys below bound, by enumerating every rank.
+static std::vector<double> ExactTopShares(uint64_t n, double constant,
+                                          uint64_t bound) {
+  ZipfianGenerator zipf(n, constant);
+  IntHasher hasher;
+  std::vector<double> mass(n);
+  for (uint64_t rank = 0; rank < n; rank++)
+    mass[hasher(rank) % n] += zipf.Probability(rank);
+  mass.resize(std::min(n, bound));
+  std::sort(mass.begin(), mass.end(), std::greater<double>());
+  std::vector<double> prefix(1, 0);
+  for (double m : mass) prefix.push_back(prefix.back() + m);
+  return prefix;
+}
+
+static void CheckScrambledZipfian(uint64_t n, double max_error) {
+  ScrambledZipfianGenerator gen(0, n, 0.99);
+  for (uint64_t bound : {n, n / 2}) {
+    auto exact = ExactTopShares(n, 0.99, bound);
+    for (uint64_t k : {n / 1000, n / 100, n / 10, n / 4}) {
+      double error = std::abs(gen.TopShareBelow(k, bound) - exact[k]);
+      Expect(error < max_error,
+             "scrambled zipfian n=" + std::to_string(n) + " bound=" +
+                 std::to_string(bound) + " k=" + std::to_string(k) +
+                 ": TopShare off by " + std::to_string(error));
+    }
+  }
+  for (uint64_t rank :
+       {uint64_t(0), uint64_t(1000), n / 2, gen.KeyCount() - 1}) {
+    Expect(gen.Probability(gen.HotKey(rank)) == gen.HotProbability(rank),
+           "scrambled zipfian: HotProbability(" + std::to_string(rank) +
+               ") differs from Probability of its key");
+  }
+}
+
+int main() {
+  for (const char* dist :
+       {"zipfian", "uniform", "hotspot", "latest", "hotspotshifting"}) {
+    CheckRunOracle(dist, 0);
+    CheckRunOracle(dist, 0.5);
+  }
+  // Every rank is exact below 2^20 keys, and beyond it the cold ranks are
+  // modelled.
+  CheckScrambledZipfian(100000, 1e-9);
+  CheckScrambledZipfian(4000000, 0.01);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+// The ops of shards 0..n-1 together must be exactly the single-process run,
+// op by op, for every request distribution.
+#include "ycsbgen.hpp"
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace YCSBGen;
+
+// (global op index, op) pairs of one shard, load phase included.
+static std::vector<std::pair<uint64_t, std::string>> Run(
+    const YCSBGeneratorOptions& options) {
+  std::vector<std::pair<uint64_t, std::string>> ops;
+  YCSBLoadGenerator loader(options);
+  while (!loader.IsEOF()) {
+    ops.emplace_back(UINT64_MAX, loader.GetNextOp().key);
+  }
+  auto gen = loader.into_run_generator();
+  uint64_t index = options.shard_id;
+  while (!gen.IsEOF()) {
+    auto op = gen.GetNextOp();
+    ops.emplace_back(index, std::to_string(int(op.type)) + op.key +
+                                std::string(op.value.data(), op.value.size()));
+    index += options.shard_count;
+  }
+  return ops;
+}
+
+int main() {
+  int failures = 0;
+  for (const char* dist :
+       {"zipfian", "uniform", "hotspot", "latest", "hotspotshifting"}) {
+    YCSBGeneratorOptions options;
+    options.record_count = 1000;
+    options.operation_count = 3001;
+    options.phase1_operation_count = 700;
+    options.read_proportion = 0.5;
+    options.insert_proportion = 0.3;
+    options.update_proportion = 0.1;
+    options.rmw_proportion = 0.1;
+    options.request_distribution = dist;
+
+    std::multiset<std::string> single_load, sharded_load;
+    std::map<uint64_t, std::string> single, sharded;
+    for (auto& op : Run(options)) {
+      if (op.first == UINT64_MAX) {
+        single_load.insert(op.second);
+      } else {
+        single.insert(op);
+      }
+    }
+    options.shard_count = 3;
+    bool overlap = false;
+    for (options.shard_id = 0; options.shard_id < options.shard_count;
+         options.shard_id++) {
+      for (auto& op : Run(options)) {
+        if (op.first == UINT64_MAX) {
+          sharded_load.insert(op.second);
+        } else if (!sharded.insert(op).second) {
+          overlap = true;
+        }
+      }
+    }
+    if (overlap || single != sharded || single_load != sharded_load) {
+      std::cerr << dist << ": the union of the shards differs from one process"
+                << std::endl;
+      failures++;
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -1,4 +1,5 @@
 #include "ycsbgen.hpp"
+#include <fstream>
 #include <iostream>
 #include <thread>
 
@@ -9,17 +10,24 @@ int main(int argc, char** argv) {
   }
   YCSBGen::YCSBGeneratorOptions options = YCSBGen::YCSBGeneratorOptions::ReadFromFile(argv[1]);
   std::cerr << options.ToString() << std::endl;
-  YCSBGen::YCSBGenerator gen(options);
+  YCSBGen::YCSBLoadGenerator loader(options);
+  {
+    std::ofstream out("load");
+    while (!loader.IsEOF()) {
+      auto op = loader.GetNextOp();
+      out << int(op.type) << ": " << op.key << "\n";
+    }
+  }
+  auto gen = loader.into_run_generator();
   std::vector<std::thread> pool;
   for(int i=0;i<1;i++) {
     pool.emplace_back([&, i]() {
-      std::mt19937_64 rndgen(i + options.base_seed);
       std::ofstream out("out"+std::to_string(i));
       while(!gen.IsEOF()) {
-        auto op = gen.GetNextOp(rndgen);
+        auto op = gen.GetNextOp();
         out << int(op.type) << ": " << op.key << ", " << std::string(op.value.data(), op.value.size()) << "\n"; 
       }
     });
   }
   for (auto& a : pool) a.join();
-}
\ No newline at end of file
+}
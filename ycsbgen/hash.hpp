@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <limits>
 #include <memory>
 
 
@@ -84,15 +86,50 @@ class Hasher {
 
 class IntHasher : public Hasher {
  public:
-  uint64_t operator()(uint64_t x) {
+  uint64_t operator()(uint64_t x) const {
     return Hash8(x, 0x202309210013);
   }
 };
 
 
+class SeededIntHasher : public Hasher {
+  size_t seed_;
+
+ public:
+  explicit SeededIntHasher(size_t seed) : seed_(seed) {}
+  uint64_t operator()(uint64_t x) const {
+    return Hash8(x, seed_);
+  }
+};
+
+
+/* SplitMix64 random engine. Its state is one word, so seeding an engine per
+ * operation is free. */
+class SplitMix64 {
+  uint64_t state_;
+
+ public:
+  typedef uint64_t result_type;
+
+  explicit SplitMix64(uint64_t seed) : state_(seed) {}
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  result_type operator()() {
+    uint64_t z = (state_ += 0x9e3779b97f4a7c15LLU);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9LLU;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebLLU;
+    return z ^ (z >> 31);
+  }
+};
+
+
 class StringHasher : public Hasher {
  public:
-  uint64_t operator()(const std::string& s) {
+  uint64_t operator()(const std::string& s) const {
     return Hash(s.data(), s.size(), 0x202309211112);
   }
 };
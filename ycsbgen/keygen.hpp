@@ -2,29 +2,75 @@
 
 #include "zipf.hpp"
 #include "hash.hpp"
+#include <algorithm>
 #include <random>
 #include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace YCSBGen {
 
 class KeyGenerator {
  public:
-  /* Generate a random key from the distribution */
-  virtual uint64_t GenKey(std::mt19937_64&) = 0;
+  virtual ~KeyGenerator() = default;
+
+  /* Generate a random key from the distribution for operation op, when
+   * key_num keys exist. Must not depend on anything else that changes during
+   * the run, so that an op is the same whichever thread generates it. */
+  virtual uint64_t GenKey(SplitMix64& rndgen, uint64_t op,
+                          uint64_t key_num) = 0;
+
+  /* Oracle of the distribution, for hit ratio bounds of caches and tiering.
+   * Keys are ranked from the hottest (rank 0) to the coldest. */
+  /* Access probability of a key. */
+  virtual double Probability(uint64_t key) const = 0;
+  /* Cumulative access probability of the k hottest keys. */
+  double TopShare(uint64_t k) const {
+    return TopShareBelow(k, std::numeric_limits<uint64_t>::max());
+  }
+  /* Cumulative access probability of the k hottest keys less than bound. */
+  virtual double TopShareBelow(uint64_t k, uint64_t bound) const = 0;
+  /* The key of a rank in [0, KeyCount()). */
+  virtual uint64_t HotKey(uint64_t rank) const = 0;
+  /* Access probability of HotKey(rank). */
+  virtual double HotProbability(uint64_t rank) const {
+    return Probability(HotKey(rank));
+  }
+  /* Number of ranks. */
+  virtual uint64_t KeyCount() const = 0;
+  /* Whether HotKey may give the same key for different ranks. */
+  virtual bool HotKeysMayRepeat() const { return false; }
 
 };
 
 class ZipfianGenerator : public KeyGenerator {
   zipf_distribution<> gen_;
+  uint64_t n_;
+  double constant_;
+  double harmonic_n_;
  
  public:
   /* zipfian constant is in [0, 1]. it is uniform when constant = 0. */
   ZipfianGenerator(uint64_t n, double constant)
-   : gen_(n, constant) {}
+   : gen_(n, constant), n_(n), constant_(constant),
+     harmonic_n_(zipf_harmonic(n, constant)) {}
 
-  uint64_t GenKey(std::mt19937_64& rndgen) override {
+  uint64_t GenKey(SplitMix64& rndgen, uint64_t, uint64_t) override {
     return gen_(rndgen);
   }
+
+  double Probability(uint64_t key) const override {
+    if (key >= n_) return 0;
+    return std::pow(key + 1.0, -constant_) / harmonic_n_;
+  }
+  double TopShareBelow(uint64_t k, uint64_t bound) const override {
+    k = std::min(k, bound);
+    if (k >= n_) return 1;
+    return zipf_harmonic(k, constant_) / harmonic_n_;
+  }
+  uint64_t HotKey(uint64_t rank) const override { return rank; }
+  uint64_t KeyCount() const override { return n_; }
 };
 
 class ScrambledZipfianGenerator : public KeyGenerator {
@@ -36,11 +82,149 @@ class ScrambledZipfianGenerator : public KeyGenerator {
   ScrambledZipfianGenerator(uint64_t l, uint64_t r, double constant) 
     : l_(l), r_(r), gen_(r - l, constant) {}
   
-  uint64_t GenKey(std::mt19937_64& rndgen) override {
-    auto ret = gen_.GenKey(rndgen);
+  uint64_t GenKey(SplitMix64& rndgen, uint64_t op, uint64_t key_num) override {
+    auto ret = gen_.GenKey(rndgen, op, key_num);
     return l_ + hasher_(ret) % (r_ - l_);
   }
 
+  /* The hash may map several zipfian ranks to one key. The hottest
+   * kExactRanks ranks are merged into distinct keys exactly. Every key also
+   * gets the expected share of the colder ranks, assuming the hash is random,
+   * and the keys they reach are ranked by the first rank mapped to them.
+   * So Probability is exact for ranges of at most kExactRanks keys. Beyond
+   * that, the cold share is a hash-averaged estimate, not the key's own, and
+   * a key reached only by cold ranks may be off by several times. */
+  double Probability(uint64_t key) const override {
+    if (key < l_ || key >= r_) return 0;
+    BuildHotKeys();
+    auto it = std::lower_bound(hot_by_key_.begin(), hot_by_key_.end(),
+                               std::make_pair(key, 0.0));
+    bool hot = it != hot_by_key_.end() && it->first == key;
+    return (hot ? it->second : 0) + cold_mass_;
+  }
+  double TopShareBelow(uint64_t k, uint64_t bound) const override {
+    BuildHotKeys();
+    uint64_t n = r_ - l_;
+    uint64_t below = std::min(std::max(bound, l_), r_) - l_;
+    if (below == 0 || k == 0) return 0;
+    double share = 0;
+    uint64_t taken = 0;
+    // Number of hot keys below bound.
+    uint64_t hot_below =
+        std::lower_bound(hot_by_key_.begin(), hot_by_key_.end(),
+                         std::make_pair(bound, 0.0)) -
+        hot_by_key_.begin();
+    if (below == n) {
+      taken = std::min<uint64_t>(k, hot_keys_.size());
+      share = hot_prefix_[taken];
+    } else if (k >= hot_below) {
+      taken = hot_below;
+      share = hot_by_key_prefix_[hot_below];
+    } else {
+      auto prefix = HotPrefixBelow(bound);
+      taken = k;
+      share = (*prefix)[taken];
+    }
+    share += taken * cold_mass_;
+    if (taken < k) {
+      // The other keys below bound are a random fraction of the cold keys.
+      double fraction = (double)below / n;
+      double exact = hot_prefix_.back() + hot_keys_.size() * cold_mass_;
+      double cold = ColdTopShare(hot_keys_.size() + (k - taken) / fraction);
+      share += fraction * std::max(0.0, cold - exact);
+    }
+    return std::min(share, 1.0);
+  }
+  uint64_t HotKey(uint64_t rank) const override {
+    BuildHotKeys();
+    if (rank < hot_keys_.size()) return hot_keys_[rank].first;
+    return l_ + hasher_(exact_ranks_ + rank - hot_keys_.size()) % (r_ - l_);
+  }
+  /* The distinct hot keys, then one rank per colder zipfian rank. */
+  uint64_t KeyCount() const override {
+    BuildHotKeys();
+    return hot_keys_.size() + (r_ - l_ - exact_ranks_);
+  }
+  bool HotKeysMayRepeat() const override { return true; }
+
+ private:
+  void BuildHotKeys() const {
+    std::call_once(hot_keys_once_, [this]() {
+      uint64_t n = r_ - l_;
+      exact_ranks_ = std::min(kExactRanks, n);
+      hot_by_key_.reserve(exact_ranks_);
+      for (uint64_t rank = 0; rank < exact_ranks_; rank++)
+        hot_by_key_.emplace_back(l_ + hasher_(rank) % n,
+                                 gen_.Probability(rank));
+      std::sort(hot_by_key_.begin(), hot_by_key_.end());
+      size_t distinct = 0;
+      for (const auto& hot : hot_by_key_) {
+        if (distinct && hot_by_key_[distinct - 1].first == hot.first) {
+          hot_by_key_[distinct - 1].second += hot.second;
+        } else {
+          hot_by_key_[distinct++] = hot;
+        }
+      }
+      hot_by_key_.resize(distinct);
+      hot_by_key_.shrink_to_fit();
+      hot_by_key_prefix_.assign(1, 0);
+      for (const auto& hot : hot_by_key_)
+        hot_by_key_prefix_.push_back(hot_by_key_prefix_.back() + hot.second);
+      hot_keys_ = hot_by_key_;
+      std::sort(hot_keys_.begin(), hot_keys_.end(),
+                [](const std::pair<uint64_t, double>& a,
+                   const std::pair<uint64_t, double>& b) {
+                  return a.second != b.second ? a.second > b.second
+                                              : a.first < b.first;
+                });
+      hot_prefix_.assign(1, 0);
+      for (const auto& hot : hot_keys_)
+        hot_prefix_.push_back(hot_prefix_.back() + hot.second);
+      cold_mass_ = (1 - gen_.TopShare(exact_ranks_)) / n;
+    });
+  }
+
+  /* Prefix sums of the masses of the hot keys below bound, by rank. Cached
+   * for the last bound asked, which is usually the number of inserted keys. */
+  std::shared_ptr<const std::vector<double>> HotPrefixBelow(
+      uint64_t bound) const {
+    std::lock_guard<std::mutex> lck(prefix_below_mutex_);
+    if (!prefix_below_ || prefix_below_bound_ != bound) {
+      auto prefix = std::make_shared<std::vector<double>>(1, 0);
+      for (const auto& hot : hot_keys_) {
+        if (hot.first < bound) prefix->push_back(prefix->back() + hot.second);
+      }
+      prefix_below_ = prefix;
+      prefix_below_bound_ = bound;
+    }
+    return prefix_below_;
+  }
+
+  /* Share of the x hottest keys once the exact ones are exhausted. t ranks
+   * reach about n(1 - e^{-t/n}) distinct keys, and the other ranks fall on
+   * these keys in proportion to their number. */
+  double ColdTopShare(double x) const {
+    double n = r_ - l_;
+    if (x >= n) return 1;
+    double t = std::max<double>(exact_ranks_, -n * std::log1p(-x / n));
+    double share = t >= n ? 1 : gen_.TopShare(t);
+    return std::min(1.0, share + (1 - share) * x / n);
+  }
+
+  static constexpr uint64_t kExactRanks = 1 << 20;
+  mutable std::once_flag hot_keys_once_;
+  mutable uint64_t exact_ranks_{0};
+  /* The distinct hot keys and their masses, by key and by rank. */
+  mutable std::vector<std::pair<uint64_t, double>> hot_by_key_;
+  mutable std::vector<double> hot_by_key_prefix_;
+  mutable std::vector<std::pair<uint64_t, double>> hot_keys_;
+  mutable std::vector<double> hot_prefix_;
+  mutable double cold_mass_{0};
+
+  mutable std::mutex prefix_below_mutex_;
+  mutable uint64_t prefix_below_bound_{0};
+  mutable std::shared_ptr<const std::vector<double>> prefix_below_;
+
 };
 
 class UniformGenerator : public KeyGenerator {
@@ -49,11 +233,21 @@ class UniformGenerator : public KeyGenerator {
  public:
   UniformGenerator(uint64_t l, uint64_t r) : l_(l), r_(r) {}
 
-  uint64_t GenKey(std::mt19937_64& rndgen) override {
+  uint64_t GenKey(SplitMix64& rndgen, uint64_t, uint64_t) override {
     std::uniform_int_distribution<> dis(l_, r_ - 1);
     return dis(rndgen);
   }
 
+  double Probability(uint64_t key) const override {
+    return key >= l_ && key < r_ ? 1.0 / (r_ - l_) : 0;
+  }
+  double TopShareBelow(uint64_t k, uint64_t bound) const override {
+    uint64_t below = std::min(std::max(bound, l_), r_) - l_;
+    return (double)std::min(k, below) / (r_ - l_);
+  }
+  uint64_t HotKey(uint64_t rank) const override { return l_ + rank; }
+  uint64_t KeyCount() const override { return r_ - l_; }
+
 };
 
 // Generate hotspot distribution in range [l, r).
@@ -65,7 +259,7 @@ class HotspotGenerator : public KeyGenerator {
   HotspotGenerator(uint64_t l, uint64_t r, uint64_t offset, double hotspot_set_fraction, double hotspot_opn_fraction)
     : l_(l), hotspot_r_(l + hotspot_set_fraction * (r - l)), r_(r), offset_(offset), hotspot_opn_fraction_(hotspot_opn_fraction) {}
 
-  uint64_t GenKey(std::mt19937_64& rndgen) override {
+  uint64_t GenKey(SplitMix64& rndgen, uint64_t, uint64_t) override {
     std::uniform_real_distribution<> dis(0, 1);
     uint64_t ret = 0;
     if (dis(rndgen) <= hotspot_opn_fraction_) {
@@ -79,6 +273,57 @@ class HotspotGenerator : public KeyGenerator {
     return ret;
   }
 
+  double Probability(uint64_t key) const override {
+    if (key < l_ || key >= r_) return 0;
+    // Undo the offset rotation of GenKey.
+    uint64_t n = r_ - l_;
+    uint64_t x = l_ + (key - l_ + n - offset_ % n) % n;
+    return x < hotspot_r_ ? HotKeyProbability() : ColdKeyProbability();
+  }
+  double TopShareBelow(uint64_t k, uint64_t bound) const override {
+    uint64_t below = std::min(std::max(bound, l_), r_) - l_;
+    uint64_t hot_below = HotKeysBelow(below);
+    uint64_t cold_below = below - hot_below;
+    uint64_t first_n = HotFirst() ? hot_below : cold_below;
+    uint64_t second_n = HotFirst() ? cold_below : hot_below;
+    double first_p = HotFirst() ? HotKeyProbability() : ColdKeyProbability();
+    double second_p = HotFirst() ? ColdKeyProbability() : HotKeyProbability();
+    if (k <= first_n) return k * first_p;
+    return first_n * first_p + std::min(k - first_n, second_n) * second_p;
+  }
+  uint64_t HotKey(uint64_t rank) const override {
+    uint64_t hot_n = hotspot_r_ - l_, cold_n = r_ - hotspot_r_;
+    uint64_t x;
+    if (HotFirst()) {
+      x = rank < hot_n ? l_ + rank : hotspot_r_ + (rank - hot_n);
+    } else {
+      x = rank < cold_n ? hotspot_r_ + rank : l_ + (rank - cold_n);
+    }
+    return l_ + (x - l_ + offset_ % (r_ - l_)) % (r_ - l_);
+  }
+  uint64_t KeyCount() const override { return r_ - l_; }
+
+ private:
+  double HotKeyProbability() const {
+    return hotspot_r_ > l_ ? hotspot_opn_fraction_ / (hotspot_r_ - l_) : 0;
+  }
+  double ColdKeyProbability() const {
+    return r_ > hotspot_r_ ? (1 - hotspot_opn_fraction_) / (r_ - hotspot_r_)
+                           : 0;
+  }
+  bool HotFirst() const { return HotKeyProbability() >= ColdKeyProbability(); }
+  /* Number of hot keys among the first `below` keys of [l, r). Undoing the
+   * rotation maps them to a cyclic interval of unshifted positions. */
+  uint64_t HotKeysBelow(uint64_t below) const {
+    uint64_t n = r_ - l_, hot_n = hotspot_r_ - l_;
+    uint64_t start = (n - offset_ % n) % n;
+    auto overlap = [hot_n](uint64_t a, uint64_t b) {
+      return std::min(b, hot_n) - std::min(a, hot_n);
+    };
+    if (start + below <= n) return overlap(start, start + below);
+    return overlap(start, n) + overlap(0, start + below - n);
+  }
+
 };
 
 // Generate hotspot distribution in range [l, r).
@@ -87,7 +332,7 @@ class HotspotShiftingGenerator : public KeyGenerator {
   HotspotGenerator phase1_gen_;
   HotspotGenerator phase2_gen_;
   uint64_t phase1_op_;
-  std::atomic<uint64_t> count_{0};
+  const std::atomic<uint64_t>* op_clock_{nullptr};
 
  public:
   struct PhaseConfig {
@@ -102,14 +347,37 @@ class HotspotShiftingGenerator : public KeyGenerator {
         phase2_gen_(l, r, phase2.offset, phase2.hotspot_set_fraction,
                     phase2.hotspot_opn_fraction),
         phase1_op_(phase1_op) {}
+  /* The oracle reports the phase of the latest operation counted by op_clock.
+   * Without it, the oracle reports phase 1. */
+  HotspotShiftingGenerator(uint64_t l, uint64_t r, PhaseConfig phase1,
+                           PhaseConfig phase2, uint64_t phase1_op,
+                           const std::atomic<uint64_t>& op_clock)
+      : HotspotShiftingGenerator(l, r, phase1, phase2, phase1_op) {
+    op_clock_ = &op_clock;
+  }
 
-  uint64_t GenKey(std::mt19937_64& rndgen) override {
-    if (count_.load(std::memory_order_relaxed) <= phase1_op_) {
-      if (count_.fetch_add(1, std::memory_order_relaxed) <= phase1_op_) {
-        return phase1_gen_.GenKey(rndgen);  
-      }
-    }
-    return phase2_gen_.GenKey(rndgen);
+  /* The first phase1_op operations are in phase 1. */
+  uint64_t GenKey(SplitMix64& rndgen, uint64_t op, uint64_t key_num) override {
+    return op < phase1_op_ ? phase1_gen_.GenKey(rndgen, op, key_num)
+                           : phase2_gen_.GenKey(rndgen, op, key_num);
+  }
+
+  /* The oracle describes the phase currently in effect. */
+  double Probability(uint64_t key) const override {
+    return CurrentPhase().Probability(key);
+  }
+  double TopShareBelow(uint64_t k, uint64_t bound) const override {
+    return CurrentPhase().TopShareBelow(k, bound);
+  }
+  uint64_t HotKey(uint64_t rank) const override {
+    return CurrentPhase().HotKey(rank);
+  }
+  uint64_t KeyCount() const override { return CurrentPhase().KeyCount(); }
+
+ private:
+  const HotspotGenerator& CurrentPhase() const {
+    auto count = op_clock_ ? op_clock_->load(std::memory_order_relaxed) : 0;
+    return count <= phase1_op_ ? phase1_gen_ : phase2_gen_;
   }
 
 };
@@ -117,19 +385,52 @@ class HotspotShiftingGenerator : public KeyGenerator {
 class LatestGenerator : public KeyGenerator {
   std::atomic<uint64_t>& now_keys_;
   zipf_distribution<> gen_;
-  uint64_t n_;
 
  public:
-  LatestGenerator(std::atomic<uint64_t>& now_keys) : now_keys_(now_keys), gen_(100), n_(100) {}
+  LatestGenerator(std::atomic<uint64_t>& now_keys) : now_keys_(now_keys), gen_(100) {}
+
+  /* Sample over the key_num keys of this op. gen_ is never resized, so the
+   * draw depends on nothing that other threads change. */
+  uint64_t GenKey(SplitMix64& rndgen, uint64_t, uint64_t key_num) override {
+    return key_num - 1 - gen_(rndgen, key_num);
+  }
 
-  uint64_t GenKey(std::mt19937_64& rndgen) override {
-    auto nw_n = now_keys_.load(std::memory_order_relaxed);
-    if (n_ != nw_n) {
-      gen_.set_n(nw_n);
-      n_ = nw_n;
+  /* The oracle follows the current now_keys_. The newest key is the hottest. */
+  double Probability(uint64_t key) const override {
+    auto n = now_keys_.load(std::memory_order_relaxed);
+    if (key >= n) return 0;
+    return std::pow(double(n - key), -gen_.s()) / Harmonic(n);
+  }
+  /* The keys below bound are the coldest ranks. */
+  double TopShareBelow(uint64_t k, uint64_t bound) const override {
+    auto n = now_keys_.load(std::memory_order_relaxed);
+    uint64_t below = std::min(bound, n);
+    uint64_t first = n - below, last = first + std::min(k, below);
+    if (first == 0 && last == n) return 1;
+    double share = first == 0 ? 0 : zipf_harmonic(first, gen_.s());
+    return (zipf_harmonic(last, gen_.s()) - share) / Harmonic(n);
+  }
+  uint64_t HotKey(uint64_t rank) const override {
+    return now_keys_.load(std::memory_order_relaxed) - 1 - rank;
+  }
+  uint64_t KeyCount() const override {
+    return now_keys_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  /* H(n, s), cached for the last n asked. */
+  double Harmonic(uint64_t n) const {
+    std::lock_guard<std::mutex> lck(harmonic_mutex_);
+    if (harmonic_n_ != n) {
+      harmonic_ = zipf_harmonic(n, gen_.s());
+      harmonic_n_ = n;
     }
-    return n_ - 1 - gen_(rndgen);
+    return harmonic_;
   }
+
+  mutable std::mutex harmonic_mutex_;
+  mutable uint64_t harmonic_n_{0};
+  mutable double harmonic_{0};
   
 };
 
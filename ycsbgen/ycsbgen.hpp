@@ -7,9 +7,13 @@
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <random>
+#include <stdexcept>
 #include <string>
 #include <thread>
+#include <unordered_set>
+#include <vector>
 
 #include "hash.hpp"
 #include "keygen.hpp"
@@ -36,6 +40,29 @@ struct YCSBGeneratorOptions {
   double phase1_hotspot_opn_fraction{0};
   double phase1_hotspot_set_fraction{0};
 
+  /* This process generates shard shard_id of shard_count. Shards load
+   * disjoint slices of the records. In the run phase, operation i belongs to
+   * shard i % shard_count and is derived from base_seed and i alone, so the
+   * shards together issue exactly the operations of a single process. */
+  uint64_t shard_id{0};
+  uint64_t shard_count{1};
+
+  void CheckShard() const {
+    if (shard_count == 0 || shard_id >= shard_count) {
+      throw std::runtime_error("Invalid shard: shardid must be less than shardcount");
+    }
+  }
+
+  /* The first item of this shard when total items are split evenly. */
+  uint64_t ShardBegin(uint64_t total) const {
+    return total / shard_count * shard_id +
+           std::min(shard_id, total % shard_count);
+  }
+  uint64_t ShardEnd(uint64_t total) const {
+    return total / shard_count * (shard_id + 1) +
+           std::min(shard_id + 1, total % shard_count);
+  }
+
   static YCSBGeneratorOptions ReadFromFile(std::string filename) {
     std::ifstream in(filename);
     std::map<std::string, std::string> names;
@@ -91,6 +118,9 @@ struct YCSBGeneratorOptions {
           std::stof(names["phase1hotspotdatafraction"]);
     else
       ret.phase1_hotspot_set_fraction = ret.hotspot_set_fraction;
+    if (names.count("shardid")) ret.shard_id = std::stoull(names["shardid"]);
+    if (names.count("shardcount")) ret.shard_count = std::stoull(names["shardcount"]);
+    ret.CheckShard();
     return ret;
   }
 
@@ -114,6 +144,8 @@ struct YCSBGeneratorOptions {
            std::to_string(phase1_hotspot_opn_fraction) + "\n";
     ret += "phase1hotspotdatafraction = " +
            std::to_string(phase1_hotspot_set_fraction) + "\n";
+    ret += "shardid = " + std::to_string(shard_id) + "\n";
+    ret += "shardcount = " + std::to_string(shard_count) + "\n";
     return ret;
   }
 
@@ -148,7 +180,8 @@ static inline std::vector<char> GenNewValue(const std::string& key,
   std::memcpy(v.data(), key.data(), std::min(v.size(), key.size()));
   return v;
 }
-static inline std::string BuildKeyName(IntHasher& key_hasher, uint64_t key) {
+static inline std::string BuildKeyName(const IntHasher& key_hasher,
+                                       uint64_t key) {
   return "user" + std::to_string(key_hasher(key));
 }
 static inline Operation GenInsert(IntHasher& key_hasher,
@@ -161,6 +194,35 @@ static inline Operation GenInsert(IntHasher& key_hasher,
   return ret;
 }
 
+/* Checkpoints are plain text: a tag line, the options fingerprint, then the generator counters. Every op is derived from base_seed and its
+ * index, so the callers' random engines are not part of the state. */
+static inline void ExpectCheckpointTag(std::istream& in,
+                                       const std::string& tag) {
+  std::string magic, name;
+  if (!(in >> magic >> name) || magic != "ycsbgen-checkpoint" || name != tag) {
+    throw std::runtime_error("Invalid checkpoint: expected " + tag);
+  }
+}
+/* A fingerprint of the options that determine the stream, shard included.
+ * load_sleep does not, so it may change on resume. */
+static inline uint64_t OptionsFingerprint(YCSBGeneratorOptions options) {
+  options.load_sleep = 0;
+  return StringHasher()(options.ToString());
+}
+static inline void SaveOptions(std::ostream& out,
+                               const YCSBGeneratorOptions& options) {
+  out << "options " << OptionsFingerprint(options) << "\n";
+}
+static inline void ExpectOptions(std::istream& in,
+                                 const YCSBGeneratorOptions& options) {
+  std::string name;
+  uint64_t fingerprint = 0;
+  if (!(in >> name >> fingerprint) || name != "options" ||
+      fingerprint != OptionsFingerprint(options)) {
+    throw std::runtime_error("Invalid checkpoint: options mismatch");
+  }
+}
+
 }  // namespace
 
 class YCSBRunGenerator;
@@ -169,16 +231,39 @@ class YCSBLoadGenerator {
  public:
   YCSBLoadGenerator(const YCSBGeneratorOptions& options,
                     uint64_t now_key_num = 0)
-      : options_(options), now_keys_(now_key_num) {}
-  bool IsEOF() const { return now_keys_ >= options_.record_count; }
+      : options_(options) {
+    options.CheckShard();
+    now_keys_ = options.ShardBegin(options.record_count) + now_key_num;
+  }
+  bool IsEOF() const {
+    return now_keys_ >= options_.ShardEnd(options_.record_count);
+  }
   Operation GetNextOp() {
     return GenInsert(key_hasher_, now_keys_, options_.value_len);
   }
+  /* Kept for compatibility. The engine is not used. */
   Operation GetNextOp(std::mt19937_64&) {
     return GetNextOp();
   }
   inline YCSBRunGenerator into_run_generator();
 
+  /* Save/restore the load progress. Worker threads must be quiesced while this
+   * is called. */
+  void SaveCheckpoint(std::ostream& out) const {
+    out << "ycsbgen-checkpoint load\n";
+    SaveOptions(out, options_);
+    out << now_keys_.load() << "\n";
+  }
+  void LoadCheckpoint(std::istream& in) {
+    ExpectCheckpointTag(in, "load");
+    ExpectOptions(in, options_);
+    uint64_t now_keys = 0;
+    if (!(in >> now_keys)) {
+      throw std::runtime_error("Invalid checkpoint: bad load counters");
+    }
+    now_keys_ = now_keys;
+  }
+
  private:
   const YCSBGeneratorOptions& options_;
   std::atomic<uint64_t> now_keys_;
@@ -188,7 +273,11 @@ class YCSBLoadGenerator {
 class YCSBRunGenerator {
  public:
   YCSBRunGenerator(const YCSBGeneratorOptions& options, size_t now_keys)
-      : options_(options), now_keys_(now_keys), now_ops_(0) {
+      : options_(options),
+        now_keys_(now_keys),
+        now_ops_(0),
+        op_hasher_(options.base_seed) {
+    options.CheckShard();
     uint64_t estimate_key_count =
         options.record_count +
         2 * options.operation_count * options.insert_proportion;
@@ -221,65 +310,189 @@ class YCSBRunGenerator {
                   .hotspot_set_fraction = options.phase1_hotspot_set_fraction,
                   .hotspot_opn_fraction = options.phase1_hotspot_opn_fraction,
               },
-              options.phase1_operation_count));
+              options.phase1_operation_count, now_ops_));
     }
   }
   bool IsEOF() const {
-    return now_ops_ >=
+    uint64_t next = now_ops_;
+    next += (options_.shard_id + options_.shard_count -
+             next % options_.shard_count) %
+            options_.shard_count;
+    return next >=
            options_.operation_count + options_.phase1_operation_count;
   }
-  Operation GetNextOp(std::mt19937_64& rndgen) {
-    now_ops_ += 1;
-    std::uniform_real_distribution<> dis(0, 1);
-    double x = dis(rndgen);
+  /* Op i is derived from base_seed, i and the number of keys inserted before
+   * it, so the stream does not depend on the callers or on sharding. When
+   * several threads share a generator, a read may be claimed before an insert
+   * claimed earlier has been counted, so its key_num depends on timing. */
+  Operation GetNextOp() {
+    uint64_t op;
+    OpType type;
+    uint64_t key;  // The inserted key, or the number of keys before the op.
+    if (options_.shard_count == 1) {
+      op = now_ops_++;
+      type = ChooseOpType(op);
+      key = type == OpType::INSERT ? now_keys_++ : now_keys_.load();
+    } else {
+      // Step over the ops of the other shards, counting their inserts, so
+      // that key indices match a single process.
+      std::lock_guard<std::mutex> lck(claim_mutex_);
+      do {
+        op = now_ops_++;
+        type = ChooseOpType(op);
+        key = type == OpType::INSERT ? now_keys_++ : now_keys_.load();
+      } while (op % options_.shard_count != options_.shard_id);
+    }
+    if (type == OpType::INSERT) {
+      return GenInsert(key);
+    }
+    SplitMix64 rndgen(op_hasher_(2 * op + 1));
+    if (type == OpType::READ) {
+      return GenRead(rndgen, op, key);
+    } else if (type == OpType::UPDATE) {
+      return GenUpdate(rndgen, op, key);
+    } else {
+      return GenRMW(rndgen, op, key);
+    }
+  }
+  /* Kept for compatibility. The engine is not used. */
+  Operation GetNextOp(std::mt19937_64&) { return GetNextOp(); }
+
+  /* Save/restore the run progress. To resume, construct the generator with
+   * the same options (now_keys is overwritten) and call LoadCheckpoint. The
+   * remaining stream is the same as if the run had not been interrupted.
+   * Worker threads must be quiesced while this is called. */
+  void SaveCheckpoint(std::ostream& out) const {
+    out << "ycsbgen-checkpoint run\n";
+    SaveOptions(out, options_);
+    out << now_keys_.load() << " " << now_ops_.load() << "\n";
+  }
+  void LoadCheckpoint(std::istream& in) {
+    ExpectCheckpointTag(in, "run");
+    ExpectOptions(in, options_);
+    uint64_t now_keys = 0, now_ops = 0;
+    if (!(in >> now_keys >> now_ops)) {
+      throw std::runtime_error("Invalid checkpoint: bad run counters");
+    }
+    now_keys_ = now_keys;
+    now_ops_ = now_ops;
+  }
+
+  /* Oracle of the key generator, over all the keys it can generate. */
+  const KeyGenerator& key_generator() const { return *key_generator_; }
+
+  /* Oracle of the read distribution. ChooseKey only accepts inserted keys, so
+   * probabilities are renormalized over them. */
+  double Probability(uint64_t key) const {
+    uint64_t key_num = now_keys_;
+    if (key >= key_num) return 0;
+    return key_generator_->Probability(key) / InsertedShare(key_num);
+  }
+  /* Cumulative access probability of the k hottest inserted keys. */
+  double TopShare(uint64_t k) const {
+    uint64_t key_num = now_keys_;
+    return key_generator_->TopShareBelow(k, key_num) / InsertedShare(key_num);
+  }
+
+  /* Iterate the inserted keys from the hottest, each once. */
+  class HotKeyIterator {
+   public:
+    explicit HotKeyIterator(const YCSBRunGenerator& gen)
+        : gen_(gen),
+          key_num_(gen.now_keys_),
+          inserted_share_(gen.InsertedShare(key_num_)),
+          rank_(0) {
+      Skip();
+    }
+    bool Valid() const { return rank_ < gen_.key_generator_->KeyCount(); }
+    void Next() {
+      rank_++;
+      Skip();
+    }
+    uint64_t rank() const { return rank_; }
+    uint64_t index() const { return gen_.key_generator_->HotKey(rank_); }
+    std::string key() const { return BuildKeyName(gen_.key_hasher_, index()); }
+    double probability() const {
+      return gen_.key_generator_->HotProbability(rank_) / inserted_share_;
+    }
+
+   private:
+    /* Skip keys not inserted yet, and repeated keys. Remembering the keys
+     * costs memory in proportion to the number iterated. */
+    void Skip() {
+      bool may_repeat = gen_.key_generator_->HotKeysMayRepeat();
+      for (; Valid(); rank_++) {
+        uint64_t key = index();
+        if (key >= key_num_) continue;
+        if (!may_repeat || seen_.insert(key).second) break;
+      }
+    }
+
+    const YCSBRunGenerator& gen_;
+    uint64_t key_num_;
+    double inserted_share_;
+    uint64_t rank_;
+    std::unordered_set<uint64_t> seen_;
+  };
+  HotKeyIterator NewHotKeyIterator() const { return HotKeyIterator(*this); }
+
+ private:
+  double InsertedShare(uint64_t key_num) const {
+    return key_generator_->TopShareBelow(std::numeric_limits<uint64_t>::max(),
+                                         key_num);
+  }
+
+  /* Cheap enough to be evaluated by every shard for every op. */
+  OpType ChooseOpType(uint64_t op) const {
+    double x = (op_hasher_(2 * op) >> 11) * 0x1.0p-53;
     if (x <= options_.read_proportion) {
-      return GenRead(rndgen);
+      return OpType::READ;
     } else if (x <= options_.read_proportion + options_.insert_proportion) {
-      return GenInsert();
+      return OpType::INSERT;
     } else if (x <= options_.read_proportion + options_.insert_proportion +
                         options_.update_proportion) {
-      return GenUpdate(rndgen);
+      return OpType::UPDATE;
     } else {
-      return GenRMW(rndgen);
+      return OpType::RMW;
     }
   }
 
- private:
-  Operation GenInsert() {
+  Operation GenInsert(uint64_t key) {
     Operation ret;
     ret.type = OpType::INSERT;
-    ret.key = BuildKeyName(key_hasher_, now_keys_++);
+    ret.key = BuildKeyName(key_hasher_, key);
     ret.value = GenNewValue(ret.key, options_.value_len);
     return ret;
   }
 
-  Operation GenRead(std::mt19937_64& rndgen) {
+  Operation GenRead(SplitMix64& rndgen, uint64_t op, uint64_t key_num) {
     Operation ret;
     ret.type = OpType::READ;
-    ret.key = ChooseKey(rndgen);
+    ret.key = ChooseKey(rndgen, op, key_num);
     return ret;
   }
 
-  Operation GenUpdate(std::mt19937_64& rndgen) {
+  Operation GenUpdate(SplitMix64& rndgen, uint64_t op, uint64_t key_num) {
     Operation ret;
     ret.type = OpType::UPDATE;
-    ret.key = ChooseKey(rndgen);
+    ret.key = ChooseKey(rndgen, op, key_num);
     ret.value = GenNewValue(ret.key, options_.value_len);
     return ret;
   }
 
-  Operation GenRMW(std::mt19937_64& rndgen) {
+  Operation GenRMW(SplitMix64& rndgen, uint64_t op, uint64_t key_num) {
     Operation ret;
     ret.type = OpType::RMW;
-    ret.key = ChooseKey(rndgen);
+    ret.key = ChooseKey(rndgen, op, key_num);
     ret.value = GenNewValue(ret.key, options_.value_len);
     return ret;
   }
 
-  std::string ChooseKey(std::mt19937_64& rndgen) {
+  /* Choose one of the key_num keys that exist before the op. */
+  std::string ChooseKey(SplitMix64& rndgen, uint64_t op, uint64_t key_num) {
     while (true) {
-      auto ret = key_generator_->GenKey(rndgen);
-      if (ret < now_keys_) {
+      auto ret = key_generator_->GenKey(rndgen, op, key_num);
+      if (ret < key_num) {
         return BuildKeyName(key_hasher_, ret);
       }
     }
@@ -287,14 +500,19 @@ class YCSBRunGenerator {
 
   const YCSBGeneratorOptions& options_;
   std::atomic<uint64_t> now_keys_;
+  /* Global index of the next op, including the ops of other shards. */
   std::atomic<uint64_t> now_ops_;
+  std::mutex claim_mutex_;
   IntHasher key_hasher_;
+  SeededIntHasher op_hasher_;
 
   std::unique_ptr<KeyGenerator> key_generator_;
 };
 
 inline YCSBRunGenerator YCSBLoadGenerator::into_run_generator() {
   std::this_thread::sleep_for(std::chrono::seconds(options_.load_sleep));
-  return YCSBRunGenerator(options_, now_keys_);
+  // Every shard starts the run phase after the whole data set is loaded.
+  return YCSBRunGenerator(options_, options_.record_count + now_keys_ -
+                                        options_.ShardEnd(options_.record_count));
 }
 }
@@ -30,6 +30,7 @@
  * MIT License.
  */
 
+#include <atomic>
 #include <random>
 #include <vector>
 #include <stdexcept>
@@ -48,6 +49,9 @@ class zipf_distribution {
   /// Zipf distribution for `N` items, in the range `[0,N - 1]` inclusive.
   /// The distribution follows the power-law 1/(n+q)^s with exponent
   /// `s` and Hurwicz q-deformation `q`.
+  ///
+  /// Only H(n) depends on `N`. The other terms are computed once at
+  /// construction and reused by set_n(), so both are O(1) for any `N`.
   zipf_distribution(const IntType n = std::numeric_limits<IntType>::max(),
       const RealType s = 1.0, const RealType q = 0.0)
     : n(n),
@@ -58,24 +62,34 @@ class zipf_distribution {
       rvs(spole ? 0.0 : 1.0 / oms),
       H_x1(H(1.5) - h(1.0)),
       H_n(H(n + 0.5)),
-      cut(1.0 - H_inv(H(1.5) - h(1.0))),
-      dist(H_x1, H_n) {
+      cut(1.0 - H_inv(H(1.5) - h(1.0))) {
     if (-0.5 >= q)
       throw std::runtime_error(
           "Range error: Parameter q must be greater than -0.5!");
   }
+  zipf_distribution(const zipf_distribution& other)
+    : n(other.n.load(std::memory_order_relaxed)),
+      _s(other._s),
+      _q(other._q),
+      oms(other.oms),
+      spole(other.spole),
+      rvs(other.rvs),
+      H_x1(other.H_x1),
+      H_n(other.H_n.load(std::memory_order_acquire)),
+      cut(other.cut) {}
   void reset() {}
 
-  IntType operator()(std::mt19937_64& rng) {
-    while (true) {
-      const RealType u = dist(rng);
-      const RealType x = H_inv(u);
-      const IntType k = std::round(x);
-      if (k - x <= cut)
-        return k - 1;
-      if (u >= H(k + 0.5) - h(k))
-        return k - 1;
-    }
+  template <class URBG>
+  IntType operator()(URBG& rng) {
+    // A single load, so a concurrent set_n() is seen entirely or not at all.
+    return sample(rng, H_n.load(std::memory_order_acquire));
+  }
+
+  /// Draw from the first `n` elements, without reading the shared n.
+  /// Costs one more evaluation of H than operator()(rng).
+  template <class URBG>
+  IntType operator()(URBG& rng, IntType n) const {
+    return sample(rng, H(n + 0.5));
   }
 
   /// Returns the parameter the distribution was constructed with.
@@ -85,24 +99,40 @@ class zipf_distribution {
   /// Returns the minimum value potentially generated by the distribution.
   result_type min() const { return 1; }
   /// Returns the maximum value potentially generated by the distribution.
-  result_type max() const { return n; }
+  result_type max() const { return n.load(std::memory_order_relaxed); }
 
-  void set_n(uint64_t new_n) {
-    H_n = H(new_n + 0.5);
-    dist = std::uniform_real_distribution<RealType>(H_x1, H_n);
+  /// Resize to `new_n` elements. This is a single evaluation of H and may
+  /// race with sampling threads, which draw from either the old or the new n.
+  void set_n(IntType new_n) {
+    H_n.store(H(new_n + 0.5), std::memory_order_release);
+    n.store(new_n, std::memory_order_relaxed);
   }
 
  private:
-  IntType n;                                      ///< Number of elements
+  std::atomic<IntType> n;                         ///< Number of elements
   RealType _s;                                    ///< Exponent
   RealType _q;                                    ///< Deformation
   RealType oms;                                   ///< 1-s
   bool spole;                                     ///< true if s near 1.0
   RealType rvs;                                   ///< 1/(1-s)
   RealType H_x1;                                  ///< H(x_1)
-  RealType H_n;                                   ///< H(n)
+  std::atomic<RealType> H_n;                      ///< H(n)
   RealType cut;                                   ///< rejection cut
-  std::uniform_real_distribution<RealType> dist;  ///< [H(x_1), H(n)]
+
+  /** Rejection-inversion over [1, n], given H_n = H(n + 0.5). */
+  template <class URBG>
+  IntType sample(URBG& rng, const RealType H_n) const {
+    while (true) {
+      const RealType u =
+          std::uniform_real_distribution<RealType>(H_x1, H_n)(rng);
+      const RealType x = H_inv(u);
+      const IntType k = std::round(x);
+      if (k - x <= cut)
+        return k - 1;
+      if (u >= H(k + 0.5) - h(k))
+        return k - 1;
+    }
+  }
 
   // This provides 16 decimal places of precision,
   // i.e. good to (epsilon)^4 / 24 per expanions log, exp below.
@@ -124,7 +154,7 @@ class zipf_distribution {
   /**
    * The hat function h(x) = 1/(x+q)^s
    */
-  const RealType h(const RealType x) { return std::pow(x + _q, -_s); }
+  const RealType h(const RealType x) const { return std::pow(x + _q, -_s); }
 
   /**
    * H(x) is an integral of h(x).
@@ -144,7 +174,7 @@ class zipf_distribution {
    * and for q != 0 and also s==1, use
    *    H(x) = [exp{(1-s) log(x+q)} - 1] / (1-s)
    */
-  const RealType H(const RealType x) {
+  const RealType H(const RealType x) const {
     if (not spole)
       return std::pow(x + _q, oms) / oms;
 
@@ -160,7 +190,7 @@ class zipf_distribution {
    * For s far away from 1.0 use the paper version
    *    H^{-1}(y) = -q + (y(1-s))^{1/(1-s)}
    */
-  const RealType H_inv(const RealType y) {
+  const RealType H_inv(const RealType y) const {
     if (not spole)
       return std::pow(y * oms, rvs) - _q;
 
@@ -168,4 +198,38 @@ class zipf_distribution {
   }
 };
 
+/**
+ * Generalized harmonic number H(n, s) = sum_{k=1}^{n} k^{-s}.
+ *
+ * The first terms are summed exactly and the tail is approximated with the
+ * Euler-Maclaurin formula, so it is O(1) for any n, with a relative error far
+ * below 1e-12.
+ */
+template <class RealType = double>
+RealType zipf_harmonic(const uint64_t n, const RealType s) {
+  constexpr uint64_t exact_terms = 64;
+  RealType sum = 0;
+  for (uint64_t k = 1; k <= std::min(n, exact_terms); k++)
+    sum += std::pow(RealType(k), -s);
+  if (n <= exact_terms)
+    return sum;
+
+  // sum_{k=a}^{b} f(k) = int_a^b f(x) dx + (f(a) + f(b)) / 2
+  //                      + (f'(b) - f'(a)) / 12 - (f'''(b) - f'''(a)) / 720
+  const RealType a = exact_terms + 1, b = n;
+  const RealType oms = 1.0 - s;
+  const RealType log_ba = std::log(b / a);
+  const RealType integral =
+      std::abs(oms * log_ba) > 1e-8
+          ? std::pow(a, oms) * std::expm1(oms * log_ba) / oms
+          : std::pow(a, oms) * log_ba;
+  auto f = [s](RealType x) { return std::pow(x, -s); };
+  auto df = [s](RealType x) { return -s * std::pow(x, -s - 1); };
+  auto d3f = [s](RealType x) {
+    return -s * (s + 1) * (s + 2) * std::pow(x, -s - 3);
+  };
+  return sum + integral + (f(a) + f(b)) / 2 + (df(b) - df(a)) / 12 -
+         (d3f(b) - d3f(a)) / 720;
+}
+
 }
\ No newline at end of file